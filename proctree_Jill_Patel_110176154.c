@@ -12,12 +12,41 @@
 #include <libgen.h>
 #include <limits.h>
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
 #include <sys/sysinfo.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
 #define TASKCOMMLEN 16
 #define PATHMAX 256
 #define HZ 100
 #define INITIAL_CAPACITY 1024
+#define PID_NAME_LEN 12
+#define MAX_SCAN_THREADS 64
+#define DIRENT_BUF_SIZE 65536
+#define URING_ENTRIES 1024
+#define URING_SLOTS 256
+#define URING_BUF_SIZE 2048
+#define QUERY_LINE_MAX 1024
+#define QUERY_MAX_TOKENS 8
+#define CGROUP_CAPTURE_ROUNDS 16
+#define CONTAIN_MAX_ROUNDS 64
+#define CONTAIN_VERIFY_MS 1000
+#define PID_DENSE_MAX 65536
+
+// Fields a command needs loaded, stat fields (pid, ppid, comm, state, times) are always read
+#define FIELD_STAT 0x0
+#define FIELD_VMRSS 0x1
+#define FIELD_SUBTREE_VMRSS 0x2
 
 // ProcInfo Structure
 typedef struct {
@@ -31,11 +60,51 @@ typedef struct {
     char comm[TASKCOMMLEN];
 } ProcInfo;
 
+// Aggregates over the descendants of one process (the process itself excluded)
+typedef struct {
+    int desc_count;
+    int child_count;
+    long max_vmrss;
+    long sum_vmrss;
+    unsigned long max_cputime;
+    unsigned long sum_cputime;
+    int oldest_idx;
+    int newest_idx;
+} SubtreeAgg;
+
 // ProcList Structure which includes procInfo
 typedef struct {
     ProcInfo *items;
     int count;
     int capacity;
+
+    // second buffer the watch mode refreshes into before swapping
+    ProcInfo *spare_items;
+    int spare_capacity;
+
+    // pid -> index lookup table rebuilt after every scan
+    int *pid_index;
+    int index_size;
+    int index_dense;
+
+    // children of items[i] are child_items[child_offsets[i] .. child_offsets[i + 1] - 1]
+    int *child_offsets;
+    int *child_items;
+    int *parent_items;
+
+    // pre-order Euler tour, subtree of items[i] is euler_order[euler_in[i] .. euler_out[i]]
+    int *euler_in;
+    int *euler_out;
+    int *euler_order;
+
+    // distance of items[i] from the top of its tree
+    int *depth;
+
+    // per-node descendant aggregates built bottom-up
+    SubtreeAgg *agg;
+
+    // set when process events changed items since the last build_indexes
+    int dirty;
 } ProcList;
 
 // Creating a proclist
@@ -46,6 +115,20 @@ ProcList *create_proclist() {
     // initializing proclist
     list->count = 0;
     list->capacity = INITIAL_CAPACITY;
+    list->spare_items = NULL;
+    list->spare_capacity = 0;
+    list->pid_index = NULL;
+    list->index_size = 0;
+    list->index_dense = 0;
+    list->child_offsets = NULL;
+    list->child_items = NULL;
+    list->parent_items = NULL;
+    list->euler_in = NULL;
+    list->euler_out = NULL;
+    list->euler_order = NULL;
+    list->depth = NULL;
+    list->agg = NULL;
+    list->dirty = 0;
 
     // allocating memory for items
     list->items = malloc(sizeof(ProcInfo) * list->capacity);
@@ -79,131 +162,822 @@ int expand_proclist(ProcList *list) {
 void free_proclist(ProcList *list) {
     if (list) {
         if (list->items) free(list->items);
+        if (list->spare_items) free(list->spare_items);
+        if (list->pid_index) free(list->pid_index);
+        if (list->child_offsets) free(list->child_offsets);
+        if (list->child_items) free(list->child_items);
+        if (list->parent_items) free(list->parent_items);
+        if (list->euler_in) free(list->euler_in);
+        if (list->euler_out) free(list->euler_out);
+        if (list->euler_order) free(list->euler_order);
+        if (list->depth) free(list->depth);
+        if (list->agg) free(list->agg);
         free(list);
     }
 }
 
-// Scanning procfs and populating proclist
-void scanprocfs(ProcList *proclist) {
+// Reading pid_max once, 0 if unknown
+long read_pid_max() {
+    static long pid_max = -1;
+    if (pid_max != -1) return pid_max;
+    pid_max = 0;
+    FILE *f = fopen("/proc/sys/kernel/pid_max", "r");
+    if (f) {
+        if (fscanf(f, "%ld", &pid_max) != 1) pid_max = 0;
+        fclose(f);
+    }
+    return pid_max;
+}
 
-    // Open /proc directory
-    DIR *procdir = opendir("/proc");
-    if (!procdir) return;
+// Hashing pid into open addressing table (Fibonacci hashing)
+static inline unsigned int hash_pid(pid_t pid, unsigned int mask) {
+    return ((unsigned int)pid * 2654435761u) & mask;
+}
 
-    struct dirent *entry;
-    proclist->count = 0;
+// Building pid -> index table, dense array when pid_max is small, open addressing otherwise
+void build_pid_index(ProcList *list) {
+    long pid_max = read_pid_max();
+    int dense = (pid_max > 0 && pid_max <= PID_DENSE_MAX);
+    int size;
+
+    if (dense) {
+        size = (int)pid_max + 1;
+    } else {
+        // power of two with load factor at most 1/2
+        size = 64;
+        while (size < list->count * 2) size = size * 2;
+    }
 
-    // as long as there are entries and we can expand proclist
-    while ((entry = readdir(procdir)) && expand_proclist(proclist)) {
-        char *endptr;
-        pid_t pid = strtol(entry->d_name, &endptr, 10);
-        if (*endptr != '\0' || pid <= 0) continue;
-
-        char statpath[PATHMAX];
-        snprintf(statpath, sizeof(statpath), "/proc/%d/stat", pid);
-        
-        FILE *statf = fopen(statpath, "r");
-        if (!statf) continue;
-        pid_t ppid;
-        unsigned long utime, stime, starttime;
-        char state;
-        if (fscanf(statf, "%d %s %c %d %lu %lu %lu", &pid, proclist->items[proclist->count].comm, &state, &ppid, &utime, &stime, &starttime) != 7) {
-            fclose(statf);
+    // reallocating table only if size changed
+    if (size != list->index_size) {
+        int *new_index = realloc(list->pid_index, sizeof(int) * size);
+        if (!new_index) {
+            // lookups fall back to linear search
+            list->index_size = 0;
+            return;
+        }
+        list->pid_index = new_index;
+        list->index_size = size;
+    }
+    list->index_dense = dense;
+    memset(list->pid_index, 0xff, sizeof(int) * size);
+
+    unsigned int mask = (unsigned int)size - 1;
+    for (int i = 0; i < list->count; i++) {
+        pid_t pid = list->items[i].pid;
+        if (dense) {
+            if (pid < size) list->pid_index[pid] = i;
             continue;
         }
-        fclose(statf);
-
-        // for all procs, populate info
-        proclist->items[proclist->count].pid = pid;
-        proclist->items[proclist->count].ppid = ppid;
-        proclist->items[proclist->count].state = state;
-        proclist->items[proclist->count].starttime = starttime;
-        proclist->items[proclist->count].cputime = utime + stime;
-
-        // Parse VmRSS from status
-        char statuspath[PATHMAX];
-        snprintf(statuspath, sizeof(statuspath), "/proc/%d/status", pid);
-        FILE *statusf = fopen(statuspath, "r");
-        proclist->items[proclist->count].vmrss = 0;
-        
-        if (statusf) {
-            char line[256];
-            while (fgets(line, sizeof(line), statusf)) {
-                if (strncmp(line, "VmRSS:", 6) == 0) {
-                    sscanf(line + 6, "%ld kB", &proclist->items[proclist->count].vmrss);
-                    proclist->items[proclist->count].vmrss *= 1024;
-                    break;
-                }
+        unsigned int slot = hash_pid(pid, mask);
+        while (list->pid_index[slot] != -1) slot = (slot + 1) & mask;
+        list->pid_index[slot] = i;
+    }
+}
+
+void build_indexes(ProcList *list);
+int build_subtree_aggs(ProcList *list);
+
+// Number of threads reading /proc, set with -j
+int scan_threads = 1;
+
+// Directory fd of /proc, opened once and reused for every openat(), page size cached alongside
+int proc_dirfd = -1;
+long page_size = 4096;
+int open_proc_dir() {
+    if (proc_dirfd == -1) {
+        proc_dirfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        page_size = sysconf(_SC_PAGESIZE);
+    }
+    return proc_dirfd;
+}
+
+// Reading <pid>/<name> below /proc with one read() into buf, NUL terminated, returns length or -1
+ssize_t read_proc_file(const char *pid_str, const char *name, char *buf, size_t size) {
+    char path[64];
+    size_t pid_len = strlen(pid_str);
+    size_t name_len = strlen(name);
+    if (pid_len + name_len + 2 > sizeof(path)) return -1;
+    memcpy(path, pid_str, pid_len);
+    path[pid_len] = '/';
+    memcpy(path + pid_len + 1, name, name_len + 1);
+
+    int fd = openat(open_proc_dir(), path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+// Parsing an unsigned decimal, advancing *p past it
+static inline unsigned long parse_ulong(const char **p) {
+    const char *c = *p;
+    unsigned long value = 0;
+    while (*c >= '0' && *c <= '9') {
+        value = value * 10 + (unsigned long)(*c - '0');
+        c++;
+    }
+    *p = c;
+    return value;
+}
+
+// Skipping n space separated fields
+static inline const char *skip_fields(const char *c, int n) {
+    while (n-- > 0 && *c) {
+        while (*c && *c != ' ') c++;
+        while (*c == ' ') c++;
+    }
+    return c;
+}
+
+// Parsing /proc/<pid>/stat, comm may hold spaces or ')' so fields are located after the last ')'
+int parse_stat(const char *buf, ProcInfo *info) {
+    const char *open_paren = strchr(buf, '(');
+    const char *close_paren = strrchr(buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren || close_paren[1] != ' ') return 0;
+
+    const char *c = buf;
+    info->pid = (pid_t)parse_ulong(&c);
+    size_t comm_len = close_paren - open_paren - 1;
+    if (comm_len >= TASKCOMMLEN) comm_len = TASKCOMMLEN - 1;
+    memcpy(info->comm, open_paren + 1, comm_len);
+    info->comm[comm_len] = '\0';
+
+    // field 3 state, 4 ppid, 14 utime, 15 stime, 22 starttime
+    c = close_paren + 2;
+    info->state = *c;
+    c = skip_fields(c, 1);
+    info->ppid = (pid_t)parse_ulong(&c);
+    c = skip_fields(c, 10);
+    unsigned long utime = parse_ulong(&c);
+    c = skip_fields(c, 1);
+    unsigned long stime = parse_ulong(&c);
+    c = skip_fields(c, 7);
+    if (*c < '0' || *c > '9') return 0;
+    info->starttime = parse_ulong(&c);
+    info->cputime = utime + stime;
+    return 1;
+}
+
+// Reading <pid>/<name> below /proc for a numeric pid
+ssize_t read_pid_file(pid_t pid, const char *name, char *buf, size_t size) {
+    // formatting digits from the end of the buffer
+    char pid_str[16];
+    char *c = pid_str + sizeof(pid_str) - 1;
+    unsigned int value = (unsigned int)pid;
+    *c = '\0';
+    do {
+        *--c = (char)('0' + value % 10);
+        value = value / 10;
+    } while (value);
+    return read_proc_file(c, name, buf, size);
+}
+
+// Parsing resident pages out of /proc/<pid>/statm into bytes, same value as VmRSS in status
+long parse_statm_vmrss(const char *buf) {
+    const char *c = skip_fields(buf, 1);
+    return (long)parse_ulong(&c) * page_size;
+}
+
+// Loading VmRSS of the subtree rooted at items[root_idx] only, then refreshing aggregates
+void load_subtree_vmrss(ProcList *list, int root_idx) {
+    if (root_idx < 0) return;
+    char buf[256];
+    for (int p = list->euler_in[root_idx]; p <= list->euler_out[root_idx]; p++) {
+        ProcInfo *info = &list->items[list->euler_order[p]];
+        info->vmrss = 0;
+        if (read_pid_file(info->pid, "statm", buf, sizeof(buf)) > 0) {
+            info->vmrss = parse_statm_vmrss(buf);
+        }
+    }
+    if (!build_subtree_aggs(list)) {
+        printf("Memory allocation failed for process index\n");
+        exit(1);
+    }
+    list->dirty = 0;
+}
+
+// Boot time in seconds since epoch, starttime is in ticks since boot
+time_t read_boot_time() {
+    struct sysinfo si;
+    time_t boot_time = time(NULL);
+    if (sysinfo(&si) == 0) boot_time = boot_time - si.uptime;
+    return boot_time;
+}
+
+// Monotonic clock in milliseconds
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Reading one process from /proc into info, 0 if it vanished or could not be parsed
+int read_proc_entry(const char *pid_str, ProcInfo *info, int fields, time_t boot_time, char *buf, size_t size) {
+    if (read_proc_file(pid_str, "stat", buf, size) <= 0) return 0;
+    if (!parse_stat(buf, info)) return 0;
+
+    // Parse VmRSS from statm, skipped unless the command needs memory of every process
+    info->vmrss = 0;
+    if ((fields & FIELD_VMRSS) && read_proc_file(pid_str, "statm", buf, size) > 0) {
+        info->vmrss = parse_statm_vmrss(buf);
+    }
+
+    // Calculate creation time by boot time + starttime
+    info->creationtime = boot_time + (time_t)(info->starttime / HZ);
+    return 1;
+}
+
+// Making room for at least n items
+int reserve_proclist(ProcList *list, int n) {
+    if (n <= list->capacity) return 1;
+    int new_capacity = list->capacity;
+    while (new_capacity < n) new_capacity = new_capacity * 2;
+    ProcInfo *new_items = realloc(list->items, sizeof(ProcInfo) * new_capacity);
+    if (!new_items) return 0;
+    list->items = new_items;
+    list->capacity = new_capacity;
+    return 1;
+}
+
+// Numeric entries of /proc collected once per scan with batched getdents64, reused across scans
+char (*pid_names)[PID_NAME_LEN] = NULL;
+int pid_names_capacity = 0;
+int list_proc_pids() {
+    int dirfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) return 0;
+
+    // layout of the records returned by getdents64
+    struct linux_dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+    char *dirbuf = malloc(DIRENT_BUF_SIZE);
+    if (!dirbuf) {
+        close(dirfd);
+        return 0;
+    }
+
+    int count = 0;
+    long nread;
+    while ((nread = syscall(SYS_getdents64, dirfd, dirbuf, DIRENT_BUF_SIZE)) > 0) {
+        for (long off = 0; off < nread;) {
+            struct linux_dirent64 *entry = (struct linux_dirent64 *)(dirbuf + off);
+            off += entry->d_reclen;
+            if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+            if (strlen(entry->d_name) >= PID_NAME_LEN) continue;
+            if (count >= pid_names_capacity) {
+                int new_capacity = pid_names_capacity ? pid_names_capacity * 2 : INITIAL_CAPACITY;
+                char (*new_names)[PID_NAME_LEN] = realloc(pid_names, sizeof(*pid_names) * new_capacity);
+                if (!new_names) break;
+                pid_names = new_names;
+                pid_names_capacity = new_capacity;
             }
-            fclose(statusf);
+            strcpy(pid_names[count++], entry->d_name);
+        }
+    }
+    free(dirbuf);
+    close(dirfd);
+    return count;
+}
+
+// io_uring ring mapped once and kept for later scans, state 0 untried, 1 ready, -1 unavailable
+typedef struct {
+    int state;
+    int ring_fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // per slot path, read buffer and read result, slot i uses registered file i
+    char (*paths)[PID_NAME_LEN + 8];
+    char (*bufs)[URING_BUF_SIZE];
+    int *results;
+} UringScanner;
+
+UringScanner uring = { 0 };
+
+// Use io_uring for reads, set with --uring
+int use_uring = 0;
+
+// Setting up the ring, sparse file table and slot buffers, 0 if io_uring is unavailable
+int uring_setup() {
+    if (uring.state != 0) return uring.state == 1;
+    uring.state = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring_fd < 0) return 0;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_size > sq_size) sq_size = cq_size;
+
+    char *sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    char *cq_ptr = sq_ptr;
+    if (sq_ptr != MAP_FAILED && !single_mmap) {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    }
+    struct io_uring_sqe *sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sq_ptr == MAP_FAILED || cq_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+        close(ring_fd);
+        return 0;
+    }
+
+    // sparse table of direct descriptors for the linked open/read/close chains
+    int files[URING_SLOTS];
+    for (int i = 0; i < URING_SLOTS; i++) files[i] = -1;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_FILES, files, URING_SLOTS) < 0) {
+        close(ring_fd);
+        return 0;
+    }
+
+    uring.paths = malloc(sizeof(*uring.paths) * URING_SLOTS);
+    uring.bufs = malloc(sizeof(*uring.bufs) * URING_SLOTS);
+    uring.results = malloc(sizeof(int) * URING_SLOTS);
+    if (!uring.paths || !uring.bufs || !uring.results) {
+        close(ring_fd);
+        return 0;
+    }
+
+    uring.ring_fd = ring_fd;
+    uring.sq_head = (unsigned *)(sq_ptr + params.sq_off.head);
+    uring.sq_tail = (unsigned *)(sq_ptr + params.sq_off.tail);
+    uring.sq_mask = (unsigned *)(sq_ptr + params.sq_off.ring_mask);
+    uring.sq_array = (unsigned *)(sq_ptr + params.sq_off.array);
+    uring.sqes = sqes;
+    uring.cq_head = (unsigned *)(cq_ptr + params.cq_off.head);
+    uring.cq_tail = (unsigned *)(cq_ptr + params.cq_off.tail);
+    uring.cq_mask = (unsigned *)(cq_ptr + params.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+    uring.state = 1;
+    return 1;
+}
+
+// Queueing one SQE, the caller never queues more than the ring holds
+struct io_uring_sqe *uring_get_sqe() {
+    unsigned tail = *uring.sq_tail;
+    unsigned idx = tail & *uring.sq_mask;
+    struct io_uring_sqe *sqe = &uring.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    uring.sq_array[idx] = idx;
+    __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// Queueing open -> read -> close of <pid>/<name> into slot, user_data is slot << 2 | op
+void uring_queue_read(int slot, const char *pid_str, const char *name) {
+    snprintf(uring.paths[slot], sizeof(uring.paths[slot]), "%s/%s", pid_str, name);
+
+    // a failed open cancels the rest, the hard link closes the slot even after a short read
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = proc_dirfd;
+    sqe->addr = (uint64_t)(uintptr_t)uring.paths[slot];
+    sqe->open_flags = O_RDONLY;
+    sqe->file_index = slot + 1;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = ((uint64_t)slot << 2) | 0;
+
+    sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot;
+    sqe->addr = (uint64_t)(uintptr_t)uring.bufs[slot];
+    sqe->len = URING_BUF_SIZE - 1;
+    sqe->off = 0;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->user_data = ((uint64_t)slot << 2) | 1;
+
+    sqe = uring_get_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = ((uint64_t)slot << 2) | 2;
+}
+
+// Submitting everything queued and reaping until all completions arrived, -1 on error
+int uring_submit_and_wait(unsigned queued) {
+    unsigned done = 0;
+    unsigned to_submit = queued;
+    while (done < queued) {
+        int ret = syscall(__NR_io_uring_enter, uring.ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        to_submit -= (unsigned)ret < to_submit ? (unsigned)ret : to_submit;
+
+        unsigned head = *uring.cq_head;
+        unsigned tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &uring.cqes[head & *uring.cq_mask];
+            int slot = (int)(cqe->user_data >> 2);
+            int op = (int)(cqe->user_data & 3);
+            if (op == 0 && cqe->res < 0) uring.results[slot] = cqe->res;
+            if (op == 1) uring.results[slot] = cqe->res;
+            head++;
+            done++;
+        }
+        __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Scanning pid_names[0 .. npids - 1] through io_uring into proclist, 0 if io_uring cannot be used
+int scan_uring(ProcList *proclist, int npids, int fields, time_t boot_time) {
+    if (!uring_setup()) return 0;
+
+    // stat and optionally statm per pid, each file takes a slot
+    int files_per_pid = (fields & FIELD_VMRSS) ? 2 : 1;
+    int batch = URING_SLOTS / files_per_pid;
+    int first_batch = 1;
+
+    for (int start = 0; start < npids; start += batch) {
+        int end = start + batch < npids ? start + batch : npids;
+        unsigned queued = 0;
+        for (int i = start; i < end; i++) {
+            int slot = (i - start) * files_per_pid;
+            uring_queue_read(slot, pid_names[i], "stat");
+            if (files_per_pid == 2) uring_queue_read(slot + 1, pid_names[i], "statm");
+            queued += 3 * files_per_pid;
+        }
+        if (uring_submit_and_wait(queued) < 0) return 0;
+
+        int opened = 0;
+        for (int i = start; i < end; i++) {
+            int slot = (i - start) * files_per_pid;
+            int len = uring.results[slot];
+            if (len != -EINVAL) opened = 1;
+            if (len <= 0) continue;
+            uring.bufs[slot][len] = '\0';
+
+            ProcInfo *info = &proclist->items[proclist->count];
+            if (!parse_stat(uring.bufs[slot], info)) continue;
+            info->vmrss = 0;
+            if (files_per_pid == 2 && uring.results[slot + 1] > 0) {
+                uring.bufs[slot + 1][uring.results[slot + 1]] = '\0';
+                info->vmrss = parse_statm_vmrss(uring.bufs[slot + 1]);
+            }
+            info->creationtime = boot_time + (time_t)(info->starttime / HZ);
+            proclist->count++;
+        }
+
+        // kernels without direct descriptors reject every open with EINVAL
+        if (first_batch && !opened) {
+            uring.state = -1;
+            proclist->count = 0;
+            return 0;
+        }
+        first_batch = 0;
+    }
+    return 1;
+}
+
+// One worker's share of the scan, results are written compactly from items[start]
+typedef struct {
+    ProcList *list;
+    int start;
+    int end;
+    int found;
+    int fields;
+    time_t boot_time;
+} ScanShard;
+
+void *scan_shard(void *arg) {
+    ScanShard *shard = arg;
+    ProcInfo *out = shard->list->items + shard->start;
+    char buf[4096];
+    shard->found = 0;
+    for (int i = shard->start; i < shard->end; i++) {
+        if (read_proc_entry(pid_names[i], &out[shard->found], shard->fields, shard->boot_time, buf, sizeof(buf))) {
+            shard->found++;
+        }
+    }
+    return NULL;
+}
+
+// Scanning procfs and populating proclist, memory is read only if fields ask for it
+void scanprocfs(ProcList *proclist, int fields) {
+    proclist->count = 0;
+    int npids = list_proc_pids();
+    if (npids == 0 || open_proc_dir() == -1 || !reserve_proclist(proclist, npids)) {
+        build_indexes(proclist);
+        return;
+    }
+    time_t boot_time = read_boot_time();
+
+    // io_uring fills the list in batches, otherwise the synchronous path is used
+    if (use_uring && scan_uring(proclist, npids, fields, boot_time)) {
+        build_indexes(proclist);
+        return;
+    }
+
+    // each worker owns a disjoint slice of items, so no locking is needed
+    int nthreads = scan_threads;
+    if (nthreads > npids) nthreads = npids;
+    if (nthreads < 1) nthreads = 1;
+    ScanShard shards[MAX_SCAN_THREADS];
+    pthread_t threads[MAX_SCAN_THREADS];
+    int started[MAX_SCAN_THREADS];
+    for (int t = 0; t < nthreads; t++) {
+        shards[t].list = proclist;
+        shards[t].start = (int)((long)npids * t / nthreads);
+        shards[t].end = (int)((long)npids * (t + 1) / nthreads);
+        shards[t].fields = fields;
+        shards[t].boot_time = boot_time;
+        // the calling thread takes the first shard itself
+        started[t] = (t > 0) && pthread_create(&threads[t], NULL, scan_shard, &shards[t]) == 0;
+    }
+    for (int t = 0; t < nthreads; t++) {
+        if (!started[t]) scan_shard(&shards[t]);
+    }
+    for (int t = 0; t < nthreads; t++) {
+        if (started[t]) pthread_join(threads[t], NULL);
+    }
+
+    // merging the compacted slices back to back
+    for (int t = 0; t < nthreads; t++) {
+        if (proclist->count != shards[t].start) {
+            memmove(proclist->items + proclist->count, proclist->items + shards[t].start, sizeof(ProcInfo) * shards[t].found);
         }
+        proclist->count += shards[t].found;
+    }
 
-        // Calculate creation time by uptime(time) - starttime
-        proclist->items[proclist->count].creationtime = time(NULL) - (starttime / HZ);
-        proclist->count++;
-    }   
-    closedir(procdir);
+    build_indexes(proclist);
 }
 
+
 // Find proc index by pid from proclist
 int find_proc_index(const ProcList *list, pid_t pid) {
-    for (int i = 0; i < list->count; i++) {
-        if (list->items[i].pid == pid) return i;
+    if (list->index_size == 0) {
+        // no index available, linear search
+        for (int i = 0; i < list->count; i++) {
+            if (list->items[i].pid == pid) return i;
+        }
+        return -1;
+    }
+    if (pid <= 0) return -1;
+
+    if (list->index_dense) {
+        return (pid < list->index_size) ? list->pid_index[pid] : -1;
+    }
+
+    // probing until the pid or an empty slot is found
+    unsigned int mask = (unsigned int)list->index_size - 1;
+    unsigned int slot = hash_pid(pid, mask);
+    while (list->pid_index[slot] != -1) {
+        int idx = list->pid_index[slot];
+        if (list->items[idx].pid == pid) return idx;
+        slot = (slot + 1) & mask;
     }
     return -1;
 }
 
+// Resizing an index array to n entries (at least one)
+int resize_index_array(int **arr, int n) {
+    int *new_arr = realloc(*arr, sizeof(int) * (n ? n : 1));
+    if (!new_arr) return 0;
+    *arr = new_arr;
+    return 1;
+}
+
+// Building CSR children index in linear time (count, prefix sum, fill)
+int build_child_index(ProcList *list) {
+    int n = list->count;
+    if (!resize_index_array(&list->child_offsets, n + 1)) return 0;
+    if (!resize_index_array(&list->child_items, n)) return 0;
+    if (!resize_index_array(&list->parent_items, n)) return 0;
+    int *offsets = list->child_offsets;
+    int *children = list->child_items;
+    int *parents = list->parent_items;
+    memset(offsets, 0, sizeof(int) * (n + 1));
+
+    // counting children per parent index
+    for (int i = 0; i < n; i++) {
+        int parent_idx = find_proc_index(list, list->items[i].ppid);
+        if (parent_idx == i) parent_idx = -1;
+        parents[i] = parent_idx;
+        if (parent_idx != -1) offsets[parent_idx + 1]++;
+    }
+    for (int i = 0; i < n; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // filling advances offsets[p] to the end of p's run, shift back afterwards
+    for (int i = 0; i < n; i++) {
+        if (parents[i] != -1) children[offsets[parents[i]]++] = i;
+    }
+    for (int i = n; i > 0; i--) {
+        offsets[i] = offsets[i - 1];
+    }
+    offsets[0] = 0;
+    return 1;
+}
+
+// Numbering nodes in pre-order with an explicit stack, every parentless node starts a tree
+int build_euler_tour(ProcList *list) {
+    int n = list->count;
+    if (!resize_index_array(&list->euler_in, n)) return 0;
+    if (!resize_index_array(&list->euler_out, n)) return 0;
+    if (!resize_index_array(&list->euler_order, n)) return 0;
+    int *stack = malloc(sizeof(int) * (n ? n : 1));
+    if (!stack) return 0;
+
+    int pos = 0;
+    for (int r = 0; r < n; r++) {
+        if (list->parent_items[r] != -1) continue;
+        int top = 0;
+        stack[top++] = r;
+        while (top > 0) {
+            int node = stack[--top];
+            list->euler_in[node] = pos;
+            list->euler_order[pos++] = node;
+
+            // pushing children in reverse so they are visited in index order
+            for (int c = list->child_offsets[node + 1] - 1; c >= list->child_offsets[node]; c--) {
+                stack[top++] = list->child_items[c];
+            }
+        }
+    }
+    free(stack);
+
+    // exit number is the exit of the last child, resolved bottom-up in reverse pre-order
+    for (int p = pos - 1; p >= 0; p--) {
+        int node = list->euler_order[p];
+        int first = list->child_offsets[node];
+        int last = list->child_offsets[node + 1] - 1;
+        list->euler_out[node] = (last >= first) ? list->euler_out[list->child_items[last]] : p;
+    }
+    return 1;
+}
+
+// Computing depths top-down, pre-order guarantees parents come first
+int build_depths(ProcList *list) {
+    if (!resize_index_array(&list->depth, list->count)) return 0;
+    for (int p = 0; p < list->count; p++) {
+        int node = list->euler_order[p];
+        int parent_idx = list->parent_items[node];
+        list->depth[node] = (parent_idx == -1) ? 0 : list->depth[parent_idx] + 1;
+    }
+    return 1;
+}
+
+// Updating oldest/newest of an aggregate with items[idx]
+static inline void fold_starttime(const ProcList *list, SubtreeAgg *a, int idx) {
+    if (idx == -1) return;
+    if (a->oldest_idx == -1 || list->items[idx].starttime < list->items[a->oldest_idx].starttime) a->oldest_idx = idx;
+    if (a->newest_idx == -1 || list->items[idx].starttime > list->items[a->newest_idx].starttime) a->newest_idx = idx;
+}
+
+// Folding every child and its own aggregate into the parent, reverse pre-order is post-order
+int build_subtree_aggs(ProcList *list) {
+    int n = list->count;
+    SubtreeAgg *aggs = realloc(list->agg, sizeof(SubtreeAgg) * (n ? n : 1));
+    if (!aggs) return 0;
+    list->agg = aggs;
+
+    for (int p = n - 1; p >= 0; p--) {
+        int node = list->euler_order[p];
+        SubtreeAgg *a = &aggs[node];
+        memset(a, 0, sizeof(SubtreeAgg));
+        a->oldest_idx = -1;
+        a->newest_idx = -1;
+
+        for (int c = list->child_offsets[node]; c < list->child_offsets[node + 1]; c++) {
+            int child = list->child_items[c];
+            const ProcInfo *ci = &list->items[child];
+            const SubtreeAgg *ca = &aggs[child];
+
+            a->desc_count += 1 + ca->desc_count;
+            a->child_count++;
+            a->sum_vmrss += ci->vmrss + ca->sum_vmrss;
+            a->sum_cputime += ci->cputime + ca->sum_cputime;
+            if (ci->vmrss > a->max_vmrss) a->max_vmrss = ci->vmrss;
+            if (ca->max_vmrss > a->max_vmrss) a->max_vmrss = ca->max_vmrss;
+            if (ci->cputime > a->max_cputime) a->max_cputime = ci->cputime;
+            if (ca->max_cputime > a->max_cputime) a->max_cputime = ca->max_cputime;
+
+            // child before its own subtree keeps the first in pre-order on ties
+            fold_starttime(list, a, child);
+            fold_starttime(list, a, ca->oldest_idx);
+            fold_starttime(list, a, ca->newest_idx);
+        }
+    }
+    return 1;
+}
+
+// Rebuilding all per-snapshot indexes after the list changed
+void build_indexes(ProcList *list) {
+    // pid lookups fall back to linear search on failure, the tree indexes cannot
+    build_pid_index(list);
+    if (!build_child_index(list) || !build_euler_tour(list) || !build_depths(list) || !build_subtree_aggs(list)) {
+        printf("Memory allocation failed for process index\n");
+        exit(1);
+    }
+}
+
+// Check if items[idx] is items[root_idx] or one of its descendants
+static inline int in_subtree(const ProcList *list, int root_idx, int idx) {
+    return list->euler_in[root_idx] <= list->euler_in[idx] && list->euler_in[idx] <= list->euler_out[root_idx];
+}
+
+// Aggregates of a pid, all zero when the pid is not in the list
+const SubtreeAgg *subtree_agg(const ProcList *list, pid_t pid) {
+    static const SubtreeAgg empty_agg = { 0, 0, 0, 0, 0, 0, -1, -1 };
+    int idx = find_proc_index(list, pid);
+    return (idx != -1) ? &list->agg[idx] : &empty_agg;
+}
+
+// Number of direct children of items[idx]
+static inline int child_count(const ProcList *list, int idx) {
+    return list->child_offsets[idx + 1] - list->child_offsets[idx];
+}
+
 // Get ppid from proclist by getting pid index and returning its ppid
 pid_t get_ppid(const ProcList *list, pid_t pid) {
     int idx = find_proc_index(list, pid);
     return (idx != -1) ? list->items[idx].ppid : -1;
 }
 
-// Check if target in in root subtree by recursive check of ppids up to root
+// Check if target in in root subtree by comparing Euler tour numbers
 int check_process_at_root(const ProcList *list, pid_t root, pid_t target) {
     if (root == target) return 1;
-    pid_t current = target;
-    while (current > 0 && current != root) {
-        current = get_ppid(list, current);
-    }
-    return (current == root);
+    int root_idx = find_proc_index(list, root);
+    int target_idx = find_proc_index(list, target);
+    if (root_idx == -1 || target_idx == -1) return 0;
+    return in_subtree(list, root_idx, target_idx);
 }
 
-// Depth calculation increasing depth until root is found
+// Depth of target relative to root from the depth index, -1 if outside the subtree
 int handle_dpt(const ProcList *list, pid_t root, pid_t target) {
-    int depth = 0;
-    pid_t current = target;
-    while (current != root && current > 0) {
-        current = get_ppid(list, current);
-        depth = depth + 1;
+    if (root == target) return 0;
+    int root_idx = find_proc_index(list, root);
+    int target_idx = find_proc_index(list, target);
+    if (root_idx == -1 || target_idx == -1 || !in_subtree(list, root_idx, target_idx)) return -1;
+    return list->depth[target_idx] - list->depth[root_idx];
+}
+
+// Number of processes per depth below root, filled by build_level_histogram
+int *level_hist = NULL;
+int level_capacity = 0;
+int level_count = 0;
+void build_level_histogram(const ProcList *list, int root_idx) {
+    level_count = 0;
+    if (root_idx < 0) return;
+
+    // the deepest level cannot exceed the subtree size
+    int first = list->euler_in[root_idx];
+    int last = list->euler_out[root_idx];
+    int needed = last - first + 1;
+    if (needed > level_capacity) {
+        int *new_hist = realloc(level_hist, sizeof(int) * needed);
+        if (!new_hist) return;
+        level_hist = new_hist;
+        level_capacity = needed;
+    }
+    memset(level_hist, 0, sizeof(int) * needed);
+
+    int base = list->depth[root_idx];
+    for (int p = first; p <= last; p++) {
+        int d = list->depth[list->euler_order[p]] - base;
+        level_hist[d]++;
+        if (d + 1 > level_count) level_count = d + 1;
     }
-    return (current == root) ? depth : -1;
 }
 
 // Collect descendants indices dynamically
 int *descendants = NULL;
 int desc_capacity = 0;
 int desc_count = 0;
-void collect_descendants(const ProcList *proclist, int parent_idx, int exclude_self) {
+void collect_descendants(const ProcList *proclist, int parent_idx) {
     desc_count = 0;
-
-    // parsing parent pid by passing parent index and getting its pid 
-    pid_t parent_pid = proclist->items[parent_idx].pid;
-    for (int i = 0; i < proclist->count; i++) {
-        if (proclist->items[i].ppid == parent_pid && (exclude_self || proclist->items[i].pid != parent_pid)) {
-
-            // increasing capacity if count > capacity upto double or set to 256 if 0
-            if (desc_count >= desc_capacity) {
-                desc_capacity = desc_capacity ? desc_capacity * 2 : 256;
-                int *new_desc = realloc(descendants, sizeof(int) * desc_capacity);
-                if (!new_desc) return;
-                descendants = new_desc;
-            }
-            descendants[desc_count++] = i;
-            // Collect deeper levels iteratively
-            collect_descendants(proclist, i, 0);
-        }
+    if (parent_idx < 0) return;
+
+    // descendants are the contiguous Euler range right after the parent
+    int first = proclist->euler_in[parent_idx] + 1;
+    int count = proclist->euler_out[parent_idx] - proclist->euler_in[parent_idx];
+    if (count > desc_capacity) {
+        int new_capacity = desc_capacity ? desc_capacity : 256;
+        while (new_capacity < count) new_capacity = new_capacity * 2;
+        int *new_desc = realloc(descendants, sizeof(int) * new_capacity);
+        if (!new_desc) return;
+        descendants = new_desc;
+        desc_capacity = new_capacity;
     }
+    memcpy(descendants, proclist->euler_order + first, sizeof(int) * count);
+    desc_count = count;
 }
 
 // 1. depth of processid
@@ -218,119 +992,124 @@ void handle_lvl(const ProcList *list, pid_t root, pid_t target) {
     // getting target depth
     int target_depth = handle_dpt(list, root, target);
 
-    // for all processes, if depth matches target depth and not root, count it
+    // processes at that depth are one histogram bucket, root itself is never counted
+    build_level_histogram(list, find_proc_index(list, root));
     int count = 0;
-    for (int i = 0; i < list->count; i++) {
-        if (list->items[i].pid == root) continue;
-        int curr_depth = handle_dpt(list, root, list->items[i].pid);
-        if (curr_depth == target_depth) count = count + 1;
-    }
+    if (target_depth > 0 && target_depth < level_count) count = level_hist[target_depth];
     printf("No. of processes at the same depth of %d in the process tree %d\n", target, count);
 }
 
-// 3. count all descendants
-void handle_cnt(const ProcList *list, pid_t root, pid_t target) {
-    int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
-    printf("%d\n", desc_count);
+// Additional command -lvls, width of every depth below root
+void handle_lvls(const ProcList *list, pid_t root, pid_t target) {
+    build_level_histogram(list, find_proc_index(list, root));
+    printf("Processes per depth in the process tree rooted at %d:\n", root);
+    for (int d = 0; d < level_count; d++) {
+        printf("Depth %d: %d\n", d, level_hist[d]);
+    }
 }
 
-ProcInfo oldest_desc, newest_desc;
-
-// Helper for oldest/newest
-void find_oldest_newest(const ProcList *list) {
-    if (desc_count == 0) return;
-
-    // making the first descendant both oldest and newest
-    int first_idx = descendants[0];
-    list->items[first_idx].pid;
-    ProcInfo old_desc = list->items[first_idx];
-    ProcInfo new_desc = list->items[first_idx];
-
-    for (int i = 1; i < desc_count; i++) {
-        int idx = descendants[i];
-
-        // lesser starttime means older process
-        if (list->items[idx].starttime < old_desc.starttime) {
-            old_desc = list->items[idx];
-        }
-        // greater starttime means newer process
-        if (list->items[idx].starttime > new_desc.starttime) {
-            new_desc = list->items[idx];
-        }
-    }
-    // Store in globals
-    oldest_desc = old_desc;
-    newest_desc = new_desc;
+// 3. count all descendants
+void handle_cnt(const ProcList *list, pid_t root, pid_t target) {
+    printf("%d\n", subtree_agg(list, target)->desc_count);
 }
 
 // 4. oldest descendant
 void handle_odt(const ProcList *list, pid_t root, pid_t target) {
-    int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
-    if (desc_count == 0) {
+    const SubtreeAgg *a = subtree_agg(list, target);
+    if (a->desc_count == 0) {
         printf("No descendants\n");
         return;
     }
-    find_oldest_newest(list);
+    const ProcInfo *oldest_desc = &list->items[a->oldest_idx];
 
     // formatting time string
     char timestr[64];
-    struct tm *tm = localtime(&oldest_desc.creationtime);
+    struct tm *tm = localtime(&oldest_desc->creationtime);
     strftime(timestr, sizeof(timestr), "%a %d %b %Y %I:%M:%S %p %Z", tm);
-    printf("Most earliest descendant of %d is %d, whose creation time is: %s\n", target, oldest_desc.pid, timestr);
+    printf("Most earliest descendant of %d is %d, whose creation time is: %s\n", target, oldest_desc->pid, timestr);
 }
 
 // 5. newest descendant
 void handle_ndt(const ProcList *list, pid_t root, pid_t target) {
-    int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
-    if (desc_count == 0) {
+    const SubtreeAgg *a = subtree_agg(list, target);
+    if (a->desc_count == 0) {
         printf("No descendants\n");
         return;
     }
-    find_oldest_newest(list);
-    printf("Most recently created descendant of %d is %d\n", target, newest_desc.pid);
+    printf("Most recently created descendant of %d is %d\n", target, list->items[a->newest_idx].pid);
 }
 
 // 6. count all non-direct descendants
 void handle_dnd(const ProcList *list, pid_t root, pid_t target) {
-    int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
-    int direct_count = 0;
-    pid_t target_pid = list->items[target_idx].pid;
-
-    // calaculating direct descendants by checking ppid of descendants
-    for (int i = 0; i < desc_count; i++) {
-        int d_idx = descendants[i];
-        if (list->items[d_idx].ppid == target_pid) direct_count = direct_count + 1;
-    }
     // calculating non-direct descendants by subracting direct from total
-    int nondirect = desc_count - direct_count;
+    const SubtreeAgg *a = subtree_agg(list, target);
+    int nondirect = a->desc_count - a->child_count;
     printf("Non-direct desc are: %d\n", nondirect);
 }
 
-// Helper for kill permissions check
-int can_kill_process(pid_t pid) {
+// Helper for kill permissions check, uses the comm loaded by the scan
+int can_kill_process(const ProcList *list, pid_t pid) {
     if (pid == 1) {
         printf("%d is a INIT process and will not be terminated\n", pid);
         return 0;
     }
-    char path[PATHMAX];
-    snprintf(path, sizeof(path), "/proc/%d/comm", pid);
-    FILE *f = fopen(path, "r");
-    if (!f) return 0;
-    char comm[32];
-    fgets(comm, sizeof(comm), f);
-    comm[strcspn(comm, "\n")] = 0;  // Trim newline
-    fclose(f);
-    if (strstr(comm, "bash") != NULL) {
+
+    // only pids found after the scan need their stat read
+    ProcInfo info;
+    const ProcInfo *proc;
+    int idx = find_proc_index(list, pid);
+    if (idx != -1) {
+        proc = &list->items[idx];
+    } else {
+        char buf[4096];
+        if (read_pid_file(pid, "stat", buf, sizeof(buf)) <= 0 || !parse_stat(buf, &info)) return 0;
+        proc = &info;
+    }
+    if (strstr(proc->comm, "bash") != NULL) {
         printf("%d is BASH process and will not be terminated\n", pid);
         return 0;
     }
     return 1;
 }
 
+// Opening a pidfd and checking the pid still belongs to the process with this starttime
+// starttime 0 skips the check, -1 with errno ESRCH if the process is gone or the pid was reused
+int open_pidfd(pid_t pid, unsigned long starttime) {
+    int pidfd = syscall(__NR_pidfd_open, pid, 0);
+    if (pidfd == -1) return -1;
+    if (starttime == 0) return pidfd;
+
+    // the pidfd pins the process, so a stat read after opening it describes the same process
+    char buf[4096];
+    ProcInfo info;
+    if (read_pid_file(pid, "stat", buf, sizeof(buf)) <= 0 || !parse_stat(buf, &info) || info.starttime != starttime) {
+        close(pidfd);
+        errno = ESRCH;
+        return -1;
+    }
+    return pidfd;
+}
+
+// Signalling through a pidfd so the signal cannot reach a process that reused the pid, 0 on success like kill()
+int signal_pid(pid_t pid, unsigned long starttime, int sig) {
+    int pidfd = open_pidfd(pid, starttime);
+    if (pidfd == -1) {
+        // kernels before 5.3 have no pidfds
+        if (errno == ENOSYS) return kill(pid, sig);
+        if (errno == ESRCH && starttime != 0) printf("%d exited or was replaced since the scan\n", pid);
+        return -1;
+    }
+    int ret = syscall(__NR_pidfd_send_signal, pidfd, sig, NULL, 0);
+    close(pidfd);
+    return ret;
+}
+
+// Signalling pid only if it is still the process from the snapshot
+int signal_process(const ProcList *list, pid_t pid, int sig) {
+    int idx = find_proc_index(list, pid);
+    return signal_pid(pid, idx == -1 ? 0 : list->items[idx].starttime, sig);
+}
+
 // 7. Kills grandparent
 void handle_kgp(const ProcList *list, pid_t root, pid_t target) {
     // get parent pid
@@ -346,9 +1125,9 @@ void handle_kgp(const ProcList *list, pid_t root, pid_t target) {
         return;
     }
     // check permissions and kill
-    if (can_kill_process(grand)) {
+    if (can_kill_process(list, grand)) {
         printf("Killing grandparent...: %d\n", grand);
-        if (kill(grand, SIGKILL) == 0) {
+        if (signal_process(list, grand, SIGKILL) == 0) {
             printf("%d is terminated\n", grand);
         } else {
             printf("Failed to kill grandparent\n");
@@ -363,9 +1142,9 @@ void handle_kpp(const ProcList *list, pid_t root, pid_t target) {
         printf("No parent for process %d\n", target);
         return;
     }
-    if (can_kill_process(parent)) {
+    if (can_kill_process(list, parent)) {
         printf("Killing parent %d\n", parent);
-        if (kill(parent, SIGKILL) == 0) {
+        if (signal_process(list, parent, SIGKILL) == 0) {
             printf("%d is terminated\n", parent);
         } else {
             printf("Failed to kill parent\n");
@@ -385,9 +1164,9 @@ void handle_ksp(const ProcList *list, pid_t root, pid_t target) {
         // if the ppid matches parent and pid is not target, it's a sibling
         if (list->items[i].ppid == parent && list->items[i].pid != target) {
             pid_t sib = list->items[i].pid;
-            if (can_kill_process(sib)) {
+            if (can_kill_process(list, sib)) {
                 printf("Killing sibling %d\n", sib);
-                if (kill(sib, SIGKILL) == 0) {
+                if (signal_process(list, sib, SIGKILL) == 0) {
                     printf("SIGKILL was sent to %d\n", sib);
                     killed_count = killed_count + 1;
                 } else {
@@ -416,9 +1195,9 @@ void handle_kps(const ProcList *list, pid_t root, pid_t target) {
     for (int i = 0; i < list->count; i++) {
         if (list->items[i].ppid == grand && list->items[i].pid != parent) {
             pid_t ua = list->items[i].pid;
-            if (can_kill_process(ua)) {
+            if (can_kill_process(list, ua)) {
                 printf("Killing uncle %d\n", ua);
-                if (kill(ua, SIGKILL) == 0) {
+                if (signal_process(list, ua, SIGKILL) == 0) {
                     printf("%d is terminated\n", ua);
                     killed_count = killed_count + 1;
                 } else {
@@ -461,9 +1240,9 @@ void handle_kgc(const ProcList *list, pid_t root, pid_t target) {
         for (int i = 0; i < list->count; i++) {
             if (list->items[i].ppid == child_pid) {
                 pid_t grandc = list->items[i].pid;
-                if (can_kill_process(grandc)) {
+                if (can_kill_process(list, grandc)) {
                     printf("Killing grandchild %d\n", grandc);
-                    if (kill(grandc, SIGKILL) == 0) {
+                    if (signal_process(list, grandc, SIGKILL) == 0) {
                         printf("%d is terminated\n", grandc);
                     } else {
                         printf("Failed to kill grandchild\n");
@@ -481,9 +1260,9 @@ void handle_kcp(const ProcList *list, pid_t root, pid_t target) {
     for (int i = 0; i < list->count; i++) {
         if (list->items[i].ppid == target) {
             pid_t child = list->items[i].pid;
-            if (can_kill_process(child)) {
+            if (can_kill_process(list, child)) {
                 printf("Killing child %d\n", child);
-                if (kill(child, SIGKILL) == 0) {
+                if (signal_process(list, child, SIGKILL) == 0) {
                     printf("SIGKILL was sent to %d\n", child);
                     killed_count = killed_count + 1;
                 } else {
@@ -497,7 +1276,7 @@ void handle_kcp(const ProcList *list, pid_t root, pid_t target) {
 // 13. Kills subtree in creation order
 void handle_kst(const ProcList *list, pid_t root, pid_t target) {
     int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
+    collect_descendants(list, target_idx);
     if (desc_count == 0) return;
 
     // Sort descendants ascending starttime (oldest first) selection sort
@@ -516,9 +1295,9 @@ void handle_kst(const ProcList *list, pid_t root, pid_t target) {
         int idx = descendants[i];
         pid_t pid = list->items[idx].pid;
 
-        if (can_kill_process(pid)) {
+        if (can_kill_process(list, pid)) {
             printf("Killing %d (created %ld)\n", pid, list->items[idx].starttime);
-            if (kill(pid, SIGKILL) == 0) {
+            if (signal_process(list, pid, SIGKILL) == 0) {
                 // formatting time string
                 char timestr[64];
                 struct tm *tm = localtime(&list->items[idx].creationtime);
@@ -534,11 +1313,11 @@ void handle_kst(const ProcList *list, pid_t root, pid_t target) {
 // 14. SIGSTOP descendants
 void handle_dst(const ProcList *list, pid_t root, pid_t target) {
     int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
+    collect_descendants(list, target_idx);
     for (int i = 0; i < desc_count; i++) {
         pid_t pid = list->items[descendants[i]].pid;
-        if (can_kill_process(pid)) {
-            kill(pid, SIGSTOP);
+        if (can_kill_process(list, pid)) {
+            signal_process(list, pid, SIGSTOP);
             printf("SIGSTOP sent to %d\n", pid);
         }
     }
@@ -547,12 +1326,12 @@ void handle_dst(const ProcList *list, pid_t root, pid_t target) {
 // 15. SIGCONT stopped descendants
 void handle_dct(const ProcList *list, pid_t root, pid_t target) {
     int target_idx = find_proc_index(list, target);
-    collect_descendants(list, target_idx, 1);
+    collect_descendants(list, target_idx);
     for (int i = 0; i < desc_count; i++) {
         int d_idx = descendants[i];
         pid_t pid = list->items[d_idx].pid;
-        if (list->items[d_idx].state == 'T' && can_kill_process(pid)) {
-            kill(pid, SIGCONT);
+        if (list->items[d_idx].state == 'T' && can_kill_process(list, pid)) {
+            signal_process(list, pid, SIGCONT);
             printf("SIGCONT sent to %d\n", pid);
         }
     }
@@ -560,9 +1339,9 @@ void handle_dct(const ProcList *list, pid_t root, pid_t target) {
 
 // 16. Kill root
 void handle_krp(const ProcList *list, pid_t root, pid_t target) {
-    if (can_kill_process(root)) {
+    if (can_kill_process(list, root)) {
         printf("Killing root %d\n", root);
-        if (kill(root, SIGKILL) == 0) {
+        if (signal_process(list, root, SIGKILL) == 0) {
             printf("%d is terminated\n", root);
         } else {
             printf("Failed to kill root\n");
@@ -570,128 +1349,468 @@ void handle_krp(const ProcList *list, pid_t root, pid_t target) {
     }
 }
 
-// Helpers for max mmd/mpd
-long find_max_vmrss(const ProcList *list, int target_idx) {
-    long max_vmrss = 0;
-    collect_descendants(list, target_idx, 1);
-    for (int i = 0; i < desc_count; i++) {
-        int idx = descendants[i];
-        if (list->items[idx].vmrss > max_vmrss) {
-            max_vmrss = list->items[idx].vmrss;
+// Open addressing set of pids, tracks processes across rescans
+typedef struct {
+    pid_t *slots;
+    int size;
+    int count;
+} PidSet;
+
+int pidset_contains(const PidSet *set, pid_t pid) {
+    if (set->size == 0) return 0;
+    unsigned int mask = (unsigned int)set->size - 1;
+    for (unsigned int slot = hash_pid(pid, mask); set->slots[slot] != 0; slot = (slot + 1) & mask) {
+        if (set->slots[slot] == pid) return 1;
+    }
+    return 0;
+}
+
+// Adding pid, 1 if it was new, 0 if already present, -1 on allocation failure
+int pidset_add(PidSet *set, pid_t pid) {
+    if (pidset_contains(set, pid)) return 0;
+
+    // doubling and rehashing at load factor 1/2
+    if ((set->count + 1) * 2 > set->size) {
+        int new_size = set->size ? set->size * 2 : 64;
+        pid_t *new_slots = calloc(new_size, sizeof(pid_t));
+        if (!new_slots) return -1;
+        unsigned int mask = (unsigned int)new_size - 1;
+        for (int i = 0; i < set->size; i++) {
+            if (set->slots[i] == 0) continue;
+            unsigned int slot = hash_pid(set->slots[i], mask);
+            while (new_slots[slot] != 0) slot = (slot + 1) & mask;
+            new_slots[slot] = set->slots[i];
         }
+        free(set->slots);
+        set->slots = new_slots;
+        set->size = new_size;
     }
-    return max_vmrss;
+    unsigned int mask = (unsigned int)set->size - 1;
+    unsigned int slot = hash_pid(pid, mask);
+    while (set->slots[slot] != 0) slot = (slot + 1) & mask;
+    set->slots[slot] = pid;
+    set->count++;
+    return 1;
 }
 
-unsigned long find_max_cpu(const ProcList *list, int target_idx) {
-    unsigned long max_cpu = 0;
-    collect_descendants(list, target_idx, 1);
-    for (int i = 0; i < desc_count; i++) {
-        int idx = descendants[i];
-        if (list->items[idx].cputime > max_cpu) {
-            max_cpu = list->items[idx].cputime;
+void pidset_free(PidSet *set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->size = 0;
+    set->count = 0;
+}
+
+// Use a cgroup v2 leaf for -dst, -dct and -kst, set with --cgroup
+int use_cgroup = 0;
+
+// Leaf cgroup for the subtree of target under the cgroup2 mount, 0 if cgroup2 is not mounted
+int cgroup_leaf_path(pid_t target, char *path, size_t size) {
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (!f) return 0;
+    char line[1024];
+    char mount_point[PATHMAX];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f)) {
+        // fstype follows the " - " separator, mount point is the fifth field
+        char *sep = strstr(line, " - cgroup2 ");
+        if (sep && sscanf(line, "%*s %*s %*s %*s %255s", mount_point) == 1) found = 1;
+    }
+    fclose(f);
+    if (!found) return 0;
+    snprintf(path, size, "%s/proctree.%d", mount_point, target);
+    return 1;
+}
+
+// Writing value into <dir>/<file>, 1 on success
+int write_cgroup_file(const char *dir, const char *file, const char *value) {
+    char path[PATHMAX + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
+    ssize_t len = write(fd, value, strlen(value));
+    close(fd);
+    return len == (ssize_t)strlen(value);
+}
+
+// Moving the descendants of target into leaf, rescanning until no descendant is left outside
+// Returns the number moved, -1 if the very first move fails (cgroup not writable)
+int cgroup_capture_descendants(ProcList *list, pid_t target, const char *leaf) {
+    char procs_path[PATHMAX + 32];
+    snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", leaf);
+    int fd = open(procs_path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) return -1;
+
+    PidSet seen = { 0 };
+    int moved = 0;
+    for (int round = 0; round < CGROUP_CAPTURE_ROUNDS; round++) {
+        int target_idx = find_proc_index(list, target);
+        if (target_idx == -1) break;
+        int added = 0;
+
+        // pre-order moves parents first, children they fork afterwards are born inside the leaf
+        for (int p = list->euler_in[target_idx] + 1; p <= list->euler_out[target_idx]; p++) {
+            pid_t pid = list->items[list->euler_order[p]].pid;
+            if (pidset_add(&seen, pid) != 1) continue;
+            added++;
+            if (!can_kill_process(list, pid)) continue;
+
+            // cgroup.procs takes one pid per write
+            char value[16];
+            int len = snprintf(value, sizeof(value), "%d", pid);
+            if (write(fd, value, len) == len) {
+                moved++;
+            } else if (moved == 0 && errno != ESRCH) {
+                close(fd);
+                pidset_free(&seen);
+                return -1;
+            }
+        }
+        if (added == 0) break;
+        scanprocfs(list, FIELD_STAT);
+    }
+    close(fd);
+    pidset_free(&seen);
+    return moved;
+}
+
+// Creating the leaf and capturing the subtree, 0 with the leaf removed if cgroup v2 cannot be used
+int cgroup_prepare(ProcList *list, pid_t target, char *leaf, size_t size) {
+    if (!cgroup_leaf_path(target, leaf, size) || (mkdir(leaf, 0755) == -1 && errno != EEXIST)) {
+        printf("cgroup v2 is not mounted or not writable, falling back to signals\n");
+        return 0;
+    }
+    if (cgroup_capture_descendants(list, target, leaf) < 0) {
+        rmdir(leaf);
+        printf("cgroup v2 is not mounted or not writable, falling back to signals\n");
+        return 0;
+    }
+    return 1;
+}
+
+// -dst through cgroup.freeze, stops the subtree including children forked later
+int cgroup_dst(ProcList *list, pid_t root, pid_t target) {
+    char leaf[PATHMAX];
+    if (!cgroup_prepare(list, target, leaf, sizeof(leaf))) return 0;
+    if (!write_cgroup_file(leaf, "cgroup.freeze", "1")) {
+        printf("Failed to freeze %s, falling back to signals\n", leaf);
+        return 0;
+    }
+    printf("Descendants of %d frozen in %s\n", target, leaf);
+    return 1;
+}
+
+// -dct through cgroup.freeze, thaws a leaf left by -dst, stopped processes still need SIGCONT
+void cgroup_dct(pid_t target) {
+    char leaf[PATHMAX];
+    if (!cgroup_leaf_path(target, leaf, sizeof(leaf)) || access(leaf, F_OK) == -1) return;
+    if (write_cgroup_file(leaf, "cgroup.freeze", "0")) {
+        printf("Descendants of %d thawed in %s\n", target, leaf);
+    }
+}
+
+// -kst through cgroup.kill, kills the whole subtree with one write
+int cgroup_kst(ProcList *list, pid_t root, pid_t target) {
+    char leaf[PATHMAX];
+    if (!cgroup_prepare(list, target, leaf, sizeof(leaf))) return 0;
+    if (!write_cgroup_file(leaf, "cgroup.kill", "1")) {
+        printf("cgroup.kill is not supported, falling back to signals\n");
+        return 0;
+    }
+    printf("Descendants of %d killed through %s\n", target, leaf);
+
+    // the leaf can be removed once the kernel has reaped every member
+    for (int i = 0; i < 100 && rmdir(leaf) == -1 && errno == EBUSY; i++) {
+        usleep(10000);
+    }
+    return 1;
+}
+
+// Growable array of pids
+typedef struct {
+    pid_t *items;
+    int count;
+    int capacity;
+} PidArray;
+
+int pidarray_push(PidArray *arr, pid_t pid) {
+    if (arr->count >= arr->capacity) {
+        int new_capacity = arr->capacity ? arr->capacity * 2 : 256;
+        pid_t *new_items = realloc(arr->items, sizeof(pid_t) * new_capacity);
+        if (!new_items) return 0;
+        arr->items = new_items;
+        arr->capacity = new_capacity;
+    }
+    arr->items[arr->count++] = pid;
+    return 1;
+}
+
+// Appending the pids listed in /proc/<pid>/task/<tid>/children, 0 if the file is missing
+int read_task_children(const char *path, PidArray *out) {
+    int fd = openat(open_proc_dir(), path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return 0;
+
+    // the list can be longer than one read, a pid may straddle two reads
+    char buf[4096];
+    pid_t partial = 0;
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < len; i++) {
+            if (buf[i] >= '0' && buf[i] <= '9') {
+                partial = partial * 10 + (buf[i] - '0');
+            } else if (partial) {
+                pidarray_push(out, partial);
+                partial = 0;
+            }
+        }
+    }
+    if (partial) pidarray_push(out, partial);
+    close(fd);
+    return 1;
+}
+
+// Descendants of target from the children files of every task, BFS without scanning all of /proc
+// out->items[0] is target itself, returns 0 if children files are unsupported
+int walk_subtree_children(pid_t target, PidArray *out) {
+    out->count = 0;
+    if (!pidarray_push(out, target)) return 0;
+    for (int head = 0; head < out->count; head++) {
+        char path[PATHMAX];
+        snprintf(path, sizeof(path), "%d/task", out->items[head]);
+        int task_fd = openat(open_proc_dir(), path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (task_fd == -1) continue;
+        DIR *task_dir = fdopendir(task_fd);
+        if (!task_dir) {
+            close(task_fd);
+            continue;
+        }
+
+        // children forked by any thread are listed under that thread
+        struct dirent *entry;
+        int found_file = 0;
+        while ((entry = readdir(task_dir))) {
+            if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+            snprintf(path, sizeof(path), "%d/task/%.16s/children", out->items[head], entry->d_name);
+            found_file |= read_task_children(path, out);
         }
+        closedir(task_dir);
+        if (head == 0 && !found_file) return 0;
     }
-    return max_cpu;
+    return 1;
+}
+
+// Check whether pid is gone or only a zombie left
+int process_is_dead(pid_t pid) {
+    char buf[4096];
+    ProcInfo info;
+    if (read_pid_file(pid, "stat", buf, sizeof(buf)) <= 0 || !parse_stat(buf, &info)) return 1;
+    return info.state == 'Z' || info.state == 'X';
+}
+
+// Additional command -kfz, SIGSTOP target and its subtree until no new pid appears, then SIGKILL the frozen set
+void handle_kfz(ProcList *list, pid_t root, pid_t target) {
+    long long start = now_ms();
+    PidSet seen = { 0 };
+    PidArray subtree = { 0 };
+    PidArray frozen = { 0 };
+    int use_children = 1;
+    int rounds = 0;
+
+    while (rounds < CONTAIN_MAX_ROUNDS) {
+        rounds = rounds + 1;
+
+        // first round uses the snapshot, later rounds only look at the subtree
+        if (rounds > 1 && use_children && !walk_subtree_children(target, &subtree)) use_children = 0;
+        if (rounds == 1 || !use_children) {
+            if (rounds > 1) scanprocfs(list, FIELD_STAT);
+            int target_idx = find_proc_index(list, target);
+            subtree.count = 0;
+            pidarray_push(&subtree, target);
+            if (target_idx != -1) {
+                for (int p = list->euler_in[target_idx] + 1; p <= list->euler_out[target_idx]; p++) {
+                    pidarray_push(&subtree, list->items[list->euler_order[p]].pid);
+                }
+            }
+        }
+
+        // target first so it stops adding children while the rest is stopped
+        int new_count = 0;
+        for (int i = 0; i < subtree.count; i++) {
+            pid_t pid = subtree.items[i];
+            if (pid == getpid() || pidset_add(&seen, pid) != 1) continue;
+            new_count = new_count + 1;
+            if (!can_kill_process(list, pid)) continue;
+
+            // pids from the children files are live, the snapshot may hold a stale entry for them
+            int ret = rounds > 1 && use_children ? signal_pid(pid, 0, SIGSTOP) : signal_process(list, pid, SIGSTOP);
+            if (ret == 0) pidarray_push(&frozen, pid);
+        }
+        printf("Round %d: %d new process(es) stopped\n", rounds, new_count);
+        if (new_count == 0) break;
+    }
+
+    // the frozen set cannot fork any more, kill all of it
+    int killed = 0;
+    for (int i = 0; i < frozen.count; i++) {
+        if (signal_pid(frozen.items[i], 0, SIGKILL) == 0) killed = killed + 1;
+    }
+
+    // verifying every killed process is gone or a zombie waiting to be reaped
+    int remaining = 0;
+    long long deadline = now_ms() + CONTAIN_VERIFY_MS;
+    do {
+        remaining = 0;
+        for (int i = 0; i < frozen.count; i++) {
+            if (!process_is_dead(frozen.items[i])) remaining = remaining + 1;
+        }
+        if (remaining) usleep(5000);
+    } while (remaining && now_ms() < deadline);
+
+    printf("Contained subtree of %d in %d round(s), killed %d, %d remaining, took %lld ms\n", target, rounds, killed, remaining, now_ms() - start);
+    pidset_free(&seen);
+    free(subtree.items);
+    free(frozen.items);
 }
 
 // 17. Most memory descendant
 void handle_mmd(const ProcList *list, pid_t root, pid_t target) {
     int target_idx = find_proc_index(list, target);
-    long max_vmrss = find_max_vmrss(list, target_idx);
+    long max_vmrss = subtree_agg(list, target)->max_vmrss;
     int listed = 0;
     
     printf("Descendant(s) of %d consuming most memory. VmRSS %ld bytes:\n", target, max_vmrss);
     
-    // in case of multiple descendants with same max vmrss (tie)
-    for (int i = 0; i < list->count; i++) {
-        if (check_process_at_root(list, target, list->items[i].pid) && list->items[i].vmrss == max_vmrss) {
-            printf("%d ", list->items[i].pid);
-            listed = listed + 1;
+    // in case of multiple descendants with same max vmrss (tie), scanning the Euler range
+    if (target_idx != -1) {
+        for (int p = list->euler_in[target_idx] + 1; p <= list->euler_out[target_idx]; p++) {
+            int idx = list->euler_order[p];
+            if (list->items[idx].vmrss == max_vmrss) {
+                printf("%d ", list->items[idx].pid);
+                listed = listed + 1;
+            }
         }
     }
     if (listed == 0) {
         printf("No descendants\n");
+    } else {
+        printf("\n");
     }
 }
 
 // 18. Most CPU descendant
 void handle_mpd(const ProcList *list, pid_t root, pid_t target) {
     int target_idx = find_proc_index(list, target);
-    unsigned long max_cpu = find_max_cpu(list, target_idx);
+    unsigned long max_cpu = subtree_agg(list, target)->max_cputime;
     int listed = 0;
 
     printf("Descendant(s) of %d with most CPU time. Total %lu clock ticks:\n", target, max_cpu);
     
-    // in case of multiple descendants with same max cputime (tie)
-    for (int i = 0; i < list->count; i++) {
-        if (check_process_at_root(list, target, list->items[i].pid) && list->items[i].cputime == max_cpu) {
-            printf("%d ", list->items[i].pid);
-            listed = listed + 1;
+    // in case of multiple descendants with same max cputime (tie), scanning the Euler range
+    if (target_idx != -1) {
+        for (int p = list->euler_in[target_idx] + 1; p <= list->euler_out[target_idx]; p++) {
+            int idx = list->euler_order[p];
+            if (list->items[idx].cputime == max_cpu) {
+                printf("%d ", list->items[idx].pid);
+                listed = listed + 1;
+            }
         }
     }
     if (listed == 0) {
         printf("No descendants\n");
+    } else {
+        printf("\n");
     }
 }
 
-// Bash count helpers
-int is_bash_subtree(const ProcList *list, pid_t pid) {
-    pid_t current = pid;
-    while (current > 0) {
-        int idx = find_proc_index(list, current);
-        if (idx != -1 && strstr(list->items[idx].comm, "bash") != NULL) return 1;
-        current = get_ppid(list, current);
+// Additional command -smd, total memory of the subtree rooted at processid
+void handle_smd(const ProcList *list, pid_t root, pid_t target) {
+    int target_idx = find_proc_index(list, target);
+    long total = subtree_agg(list, target)->sum_vmrss;
+    if (target_idx != -1) total += list->items[target_idx].vmrss;
+    printf("Total VmRSS of the process subtree rooted at %d is %ld bytes\n", target, total);
+}
+
+// Additional command -spd, total CPU time of the subtree rooted at processid
+void handle_spd(const ProcList *list, pid_t root, pid_t target) {
+    int target_idx = find_proc_index(list, target);
+    unsigned long total = subtree_agg(list, target)->sum_cputime;
+    if (target_idx != -1) total += list->items[target_idx].cputime;
+    printf("Total CPU time of the process subtree rooted at %d is %lu clock ticks\n", target, total);
+}
+
+// Bash count helper, one top-down sweep passing "has a bash ancestor (or is bash)" to children
+char *mark_bash_subtrees(const ProcList *list) {
+    char *under_bash = malloc(list->count ? list->count : 1);
+    if (!under_bash) return NULL;
+    for (int p = 0; p < list->count; p++) {
+        int node = list->euler_order[p];
+        int parent_idx = list->parent_items[node];
+        under_bash[node] = (parent_idx != -1 && under_bash[parent_idx]) || strstr(list->items[node].comm, "bash") != NULL;
     }
-    return 0;
+    return under_bash;
 }
 
 // Additional command -bcp
-int count_bcp(const ProcList *list) {
+int count_bcp(const ProcList *list, const char *under_bash) {
     int count = 0;
     pid_t self_pid = getpid();
     for (int i = 0; i < list->count; i++) {
-        if (is_bash_subtree(list, list->items[i].pid) && list->items[i].pid != self_pid)
+        if (under_bash[i] && list->items[i].pid != self_pid)
             count = count + 1;
     }
     return count;
 }
 void handle_bcp(ProcList *list) {
-    scanprocfs(list);
-    printf("%d\n", count_bcp(list));
+    char *under_bash = mark_bash_subtrees(list);
+    if (!under_bash) {
+        printf("Memory allocation failed for bash flags\n");
+        return;
+    }
+    printf("%d\n", count_bcp(list, under_bash));
+    free(under_bash);
 }
 
 // Additional command -bop
-int count_bop(const ProcList *list) {
+int count_bop(const ProcList *list, const char *under_bash) {
     int count = 0;
     for (int i = 0; i < list->count; i++) {
-        if (!is_bash_subtree(list, list->items[i].pid) && list->items[i].pid > 1)
+        if (!under_bash[i] && list->items[i].pid > 1)
             count = count + 1;
     }
     return count;
 }
 void handle_bop(ProcList *list) {
-    scanprocfs(list);
-    printf("%d\n", count_bop(list));
-}
-
-// Main Function
-int main(int num_args, char *arguments[]) {
-
-    if (num_args != 2 && num_args != 3 && num_args != 4) {
-        printf("Invalid number of arguments\n");
-        return 1;
-    }
-
-    // Creating proc list
-    ProcList *proclist = create_proclist();
-    if (!proclist) {
-        printf("Memory allocation failed for proc list\n");
-        return 1;
+    char *under_bash = mark_bash_subtrees(list);
+    if (!under_bash) {
+        printf("Memory allocation failed for bash flags\n");
+        return;
     }
-    // scanning proc
-    scanprocfs(proclist);
+    printf("%d\n", count_bop(list, under_bash));
+    free(under_bash);
+}
 
+// Commands taking <rootpid> <pid> <option>
+const char *tree_commands[] = {
+    "-dpt", "-lvl", "-cnt", "-odt", "-ndt", "-dnd", "-kgp", "-kpp", "-ksp", "-kps", "-kgc", "-kcp", "-kst", "-dst", "-dct", "-krp", "-mmd", "-mpd", "-lvls", "-smd", "-spd", "-kfz"
+};
+#define TREE_COMMAND_COUNT (int)(sizeof(tree_commands) / sizeof(tree_commands[0]))
+
+// Fields each command reads beyond the tree, memory commands only need their subtree
+const int tree_command_fields[] = {
+    FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT,
+    FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_STAT, FIELD_SUBTREE_VMRSS, FIELD_STAT, FIELD_STAT, FIELD_SUBTREE_VMRSS, FIELD_STAT,
+    FIELD_STAT
+};
+
+// Commands that send signals (kill, stop, continue)
+const int tree_command_signals[] = {
+    0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 1
+};
+
+// Signalling commands are allowed on the command line, queries from stdin need --allow-kill
+int allow_signals = 1;
+
+// Running one command given in argv form (arguments[0] unused) against proclist, scanning first if scan is set
+int execute_command(ProcList *proclist, int num_args, char *arguments[], int scan) {
     if (num_args == 2) {
         // No process ID provided (Additional commands)
         // Array of valid commands
@@ -699,6 +1818,8 @@ int main(int num_args, char *arguments[]) {
 
         for (int i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
             if (strcmp(arguments[1], commands[i]) == 0) {
+                // both only need the tree and comm
+                if (scan) scanprocfs(proclist, FIELD_STAT);
                 switch (i + 1) {
                     case 1: 
                         handle_bcp(proclist); break;
@@ -709,8 +1830,6 @@ int main(int num_args, char *arguments[]) {
                     default:
                         printf("Invalid command\n"); return 1;
                 }
-                free_proclist(proclist);
-                free(descendants);
                 return 0;
             }
         }
@@ -721,29 +1840,29 @@ int main(int num_args, char *arguments[]) {
         // no option received
         pid_t root_process = atoi(arguments[1]);
         pid_t process_id = atoi(arguments[2]);
+        if (scan) scanprocfs(proclist, FIELD_STAT);
         if(check_process_at_root(proclist, root_process, process_id)) {
             pid_t ppid = get_ppid(proclist, process_id);
             printf("Pid is: %d and PPID is: %d\n", process_id, ppid);
         } else {
             printf("Process %d does not belong to the process subtree rooted at %d\n", process_id, root_process);
         }
-        free_proclist(proclist);
-        free(descendants);
         return 0;
     }
 
 
     if (num_args == 4) {
         // option received
-        // Array of valid commands
-        const char *commands[] = {
-            "-dpt", "-lvl", "-cnt", "-odt", "-ndt", "-dnd", "-kgp", "-kpp", "-ksp", "-kps", "-kgc", "-kcp", "-kst", "-dst", "-dct", "-krp", "-mmd", "-mpd"
-        };
-
-        for (int i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        for (int i = 0; i < TREE_COMMAND_COUNT; i++) {
 
             char *option = arguments[3];
-            if (strcmp(option, commands[i]) == 0) {
+            if (strcmp(option, tree_commands[i]) == 0) {
+
+                // signalling from a batch or watch query needs --allow-kill
+                if (tree_command_signals[i] && !allow_signals) {
+                    printf("%s sends signals, rerun with --allow-kill to permit it\n", option);
+                    return 1;
+                }
 
                 // sting to int conversion
                 pid_t root_process = atoi(arguments[1]);
@@ -751,11 +1870,17 @@ int main(int num_args, char *arguments[]) {
 
                 if (root_process <= 0 || process_id <= 0) {
                     printf("Invalid PID: %d or %d\n", root_process, process_id);
-                    free_proclist(proclist);
-                    if (descendants) free(descendants);
                     return 1;
                 }
 
+                // scanning proc, expensive fields only for the target subtree
+                if (scan) {
+                    scanprocfs(proclist, tree_command_fields[i] & FIELD_VMRSS);
+                    if (tree_command_fields[i] & FIELD_SUBTREE_VMRSS) {
+                        load_subtree_vmrss(proclist, find_proc_index(proclist, process_id));
+                    }
+                }
+
                 if (check_process_at_root(proclist, root_process, process_id)) {
                     
                     switch (i + 1) {
@@ -796,12 +1921,15 @@ int main(int num_args, char *arguments[]) {
                             handle_kcp(proclist, root_process, process_id); break;
 
                         case 13:
+                            if (use_cgroup && cgroup_kst(proclist, root_process, process_id)) break;
                             handle_kst(proclist, root_process, process_id); break;
 
                         case 14:
+                            if (use_cgroup && cgroup_dst(proclist, root_process, process_id)) break;
                             handle_dst(proclist, root_process, process_id); break;
 
                         case 15:
+                            if (use_cgroup) cgroup_dct(process_id);
                             handle_dct(proclist, root_process, process_id); break;
 
                         case 16:
@@ -813,6 +1941,18 @@ int main(int num_args, char *arguments[]) {
                         case 18:
                             handle_mpd(proclist, root_process, process_id); break;
 
+                        case 19:
+                            handle_lvls(proclist, root_process, process_id); break;
+
+                        case 20:
+                            handle_smd(proclist, root_process, process_id); break;
+
+                        case 21:
+                            handle_spd(proclist, root_process, process_id); break;
+
+                        case 22:
+                            handle_kfz(proclist, root_process, process_id); break;
+
                         default:
                             printf("Invalid command\n"); return 1;
                     }
@@ -821,7 +1961,487 @@ int main(int num_args, char *arguments[]) {
                     printf("Process %d does not belong to the process subtree rooted at %d\n", process_id, root_process);
                     return 1;
                 }
+                return 0;
+            }
+        }
+    }
+    printf("Invalid command\n");
+    return 1;
+}
+
+// Fields a query line needs loaded for every process, used to pick one scan for a whole batch
+int query_fields(const char *line) {
+    char copy[QUERY_LINE_MAX];
+    char *tokens[4];
+    int num_tokens = 0;
+    char *saveptr = NULL;
+    snprintf(copy, sizeof(copy), "%s", line);
+    for (char *tok = strtok_r(copy, " \t\r\n", &saveptr); tok && num_tokens < 4; tok = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        tokens[num_tokens++] = tok;
+    }
+    if (num_tokens != 3) return FIELD_STAT;
+    for (int i = 0; i < TREE_COMMAND_COUNT; i++) {
+        if (strcmp(tokens[2], tree_commands[i]) == 0 && tree_command_fields[i] != FIELD_STAT) return FIELD_VMRSS;
+    }
+    return FIELD_STAT;
+}
+
+// Refreshing the snapshot in place, (pid, starttime) decides whether an entry is the same process
+void refresh_procfs(ProcList *list) {
+    int npids = list_proc_pids();
+    if (npids > list->spare_capacity) {
+        ProcInfo *new_spare = realloc(list->spare_items, sizeof(ProcInfo) * npids);
+        if (!new_spare) return;
+        list->spare_items = new_spare;
+        list->spare_capacity = npids;
+    }
+    time_t boot_time = read_boot_time();
+    char buf[4096];
+
+    // pids missing from the listing are dropped simply by not being copied
+    int count = 0;
+    for (int i = 0; i < npids; i++) {
+        ProcInfo *info = &list->spare_items[count];
+        if (read_proc_file(pid_names[i], "stat", buf, sizeof(buf)) <= 0) continue;
+
+        int old_idx = find_proc_index(list, (pid_t)atoi(pid_names[i]));
+        if (old_idx != -1) *info = list->items[old_idx];
+        unsigned long old_starttime = info->starttime;
+        if (!parse_stat(buf, info)) continue;
+
+        // new pid or pid reused by another process, creation time is derived once
+        if (old_idx == -1 || info->starttime != old_starttime) {
+            info->creationtime = boot_time + (time_t)(info->starttime / HZ);
+        }
+
+        // volatile fields, state/ppid/times come from stat above, memory from statm
+        info->vmrss = 0;
+        if (read_proc_file(pid_names[i], "statm", buf, sizeof(buf)) > 0) {
+            info->vmrss = parse_statm_vmrss(buf);
+        }
+        count++;
+    }
+
+    // swapping buffers so the old one becomes the next spare
+    ProcInfo *old_items = list->items;
+    int old_capacity = list->capacity;
+    list->items = list->spare_items;
+    list->capacity = list->spare_capacity;
+    list->spare_items = old_items;
+    list->spare_capacity = old_capacity;
+    list->count = count;
+    build_indexes(list);
+}
+
+// Netlink proc connector socket subscribed to fork/exec/exit events, -1 if unavailable
+int open_proc_events() {
+    int sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (sock == -1) return -1;
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    addr.nl_pid = getpid();
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    // a large receive buffer makes ENOBUFS under fork storms rarer
+    int rcvbuf = 4 * 1024 * 1024;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1) {
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    char msg[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+    memset(msg, 0, sizeof(msg));
+    struct nlmsghdr *nlh = (struct nlmsghdr *)msg;
+    nlh->nlmsg_len = sizeof(msg);
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_pid = getpid();
+    struct cn_msg *cn = NLMSG_DATA(nlh);
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(enum proc_cn_mcast_op);
+    *(enum proc_cn_mcast_op *)cn->data = PROC_CN_MCAST_LISTEN;
+    if (send(sock, msg, sizeof(msg), 0) == -1) {
+        close(sock);
+        return -1;
+    }
+
+    // some kernels and network namespaces accept the subscription but never deliver,
+    // so forking a throwaway child and waiting for its event proves the channel works
+    pid_t probe = fork();
+    if (probe == 0) _exit(0);
+    if (probe > 0) waitpid(probe, NULL, 0);
+    long long deadline = now_ms() + 500;
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (probe > 0) {
+        long long left = deadline - now_ms();
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (left <= 0 || poll(&pfd, 1, (int)left) != 1) break;
+        ssize_t len = recv(sock, buf, sizeof(buf), 0);
+        if (len <= 0) break;
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)len); h = NLMSG_NEXT(h, len)) {
+            const struct proc_event *ev = (const struct proc_event *)((struct cn_msg *)NLMSG_DATA(h))->data;
+            if (ev->what == PROC_EVENT_FORK && ev->event_data.fork.child_tgid == probe) return sock;
+        }
+    }
+    close(sock);
+    return -1;
+}
+
+// Adding items[idx] to the pid index without a full rebuild
+void index_insert(ProcList *list, int idx) {
+    pid_t pid = list->items[idx].pid;
+    if (list->index_size == 0) return;
+    if (list->index_dense) {
+        if (pid < list->index_size) list->pid_index[pid] = idx;
+        return;
+    }
+    // keeping the load factor at most 1/2
+    if (list->count * 2 > list->index_size) {
+        build_pid_index(list);
+        return;
+    }
+    unsigned int mask = (unsigned int)list->index_size - 1;
+    unsigned int slot = hash_pid(pid, mask);
+    while (list->pid_index[slot] != -1) slot = (slot + 1) & mask;
+    list->pid_index[slot] = idx;
+}
+
+// Marking items[idx] as exited, hash slots stay occupied so probe chains are kept intact
+void index_remove(ProcList *list, int idx) {
+    pid_t pid = list->items[idx].pid;
+    if (list->index_size != 0 && list->index_dense && pid < list->index_size) list->pid_index[pid] = -1;
+    list->items[idx].pid = 0;
+}
+
+// Applying one kernel process event to the list, tree indexes are rebuilt lazily
+void apply_proc_event(ProcList *list, const struct proc_event *ev) {
+    char buf[4096];
+    switch (ev->what) {
+        case PROC_EVENT_FORK: {
+            // thread creation shows up as fork too, only new thread groups are processes
+            pid_t child = ev->event_data.fork.child_tgid;
+            if (ev->event_data.fork.child_pid != child || find_proc_index(list, child) != -1) return;
+            if (!expand_proclist(list)) return;
+
+            // inheriting the parent's entry until /proc can be read
+            ProcInfo *info = &list->items[list->count];
+            int parent_idx = find_proc_index(list, ev->event_data.fork.parent_tgid);
+            if (parent_idx != -1) {
+                *info = list->items[parent_idx];
+            } else {
+                memset(info, 0, sizeof(ProcInfo));
+                info->state = 'R';
+            }
+            info->pid = child;
+            info->ppid = ev->event_data.fork.parent_tgid;
+            info->cputime = 0;
+            info->starttime = ev->timestamp_ns / (1000000000ULL / HZ);
+            info->creationtime = time(NULL);
+            if (read_pid_file(child, "stat", buf, sizeof(buf)) > 0) parse_stat(buf, info);
+            info->pid = child;
+
+            list->count++;
+            index_insert(list, list->count - 1);
+            list->dirty = 1;
+            break;
+        }
+        case PROC_EVENT_EXEC: {
+            // exec changes comm, re-reading stat picks it up
+            int idx = find_proc_index(list, ev->event_data.exec.process_tgid);
+            if (idx != -1 && read_pid_file(list->items[idx].pid, "stat", buf, sizeof(buf)) > 0) {
+                parse_stat(buf, &list->items[idx]);
+                list->dirty = 1;
             }
+            break;
+        }
+        case PROC_EVENT_EXIT: {
+            // only the thread group leader leaving ends the process
+            if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid) return;
+            int idx = find_proc_index(list, ev->event_data.exit.process_tgid);
+            if (idx != -1) {
+                index_remove(list, idx);
+                list->dirty = 1;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Folding event changes into the indexes: reparent orphans, drop exited entries, rebuild
+void apply_tree_changes(ProcList *list) {
+    if (!list->dirty) return;
+    char buf[4096];
+
+    // children of an exited process were moved to init or a subreaper, /proc knows which
+    for (int i = 0; i < list->count; i++) {
+        ProcInfo *info = &list->items[i];
+        if (info->pid == 0 || info->ppid <= 0 || find_proc_index(list, info->ppid) != -1) continue;
+        ProcInfo fresh = *info;
+        if (read_pid_file(info->pid, "stat", buf, sizeof(buf)) > 0 && parse_stat(buf, &fresh) && fresh.starttime == info->starttime) {
+            info->ppid = fresh.ppid;
+        } else {
+            info->ppid = 1;
+        }
+    }
+
+    int count = 0;
+    for (int i = 0; i < list->count; i++) {
+        if (list->items[i].pid == 0) continue;
+        if (count != i) list->items[count] = list->items[i];
+        count++;
+    }
+    list->count = count;
+    build_indexes(list);
+}
+
+// Draining the connector socket, returns 0 when events were lost and a rescan is needed
+int read_proc_events(ProcList *list, int sock) {
+    char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (1) {
+        ssize_t len = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 1;
+            return errno != ENOBUFS;
         }
-    }    
-}
\ No newline at end of file
+        for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, (size_t)len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_NOOP) continue;
+            struct cn_msg *cn = NLMSG_DATA(nlh);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) continue;
+            apply_proc_event(list, (const struct proc_event *)cn->data);
+        }
+    }
+}
+
+// Splitting a query line into argv form and running it against the current snapshot
+int run_query_line(ProcList *proclist, char *line) {
+    char *tokens[QUERY_MAX_TOKENS + 1];
+    int num_tokens = 1;
+    char *saveptr = NULL;
+    tokens[0] = "proctree";
+    for (char *tok = strtok_r(line, " \t\r", &saveptr); tok; tok = strtok_r(NULL, " \t\r", &saveptr)) {
+        if (num_tokens > QUERY_MAX_TOKENS) break;
+        tokens[num_tokens++] = tok;
+    }
+    // blank lines are ignored
+    if (num_tokens == 1) return 0;
+    apply_tree_changes(proclist);
+    if (num_tokens > 4) {
+        printf("Invalid number of arguments\n");
+        return 1;
+    }
+    return execute_command(proclist, num_tokens, tokens, 0);
+}
+
+// Batch mode, runs every query line of in against one snapshot, one "# <query>" headed block per line
+int run_batch(ProcList *proclist, FILE *in) {
+    char **lines = NULL;
+    int num_lines = 0;
+    int lines_capacity = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    int fields = FIELD_STAT;
+
+    // reading everything first so the single scan can load what every query needs
+    while (getline(&line, &line_size, in) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (num_lines >= lines_capacity) {
+            lines_capacity = lines_capacity ? lines_capacity * 2 : 64;
+            char **new_lines = realloc(lines, sizeof(char *) * lines_capacity);
+            if (!new_lines) break;
+            lines = new_lines;
+        }
+        lines[num_lines] = strdup(line);
+        if (!lines[num_lines]) break;
+        fields |= query_fields(lines[num_lines]);
+        num_lines++;
+    }
+    free(line);
+
+    scanprocfs(proclist, fields);
+
+    int failed = 0;
+    for (int i = 0; i < num_lines; i++) {
+        if (strspn(lines[i], " \t") != strlen(lines[i])) {
+            printf("# %s\n", lines[i]);
+            if (run_query_line(proclist, lines[i]) != 0) failed = 1;
+        }
+        free(lines[i]);
+    }
+    free(lines);
+    fflush(stdout);
+    return failed;
+}
+
+volatile sig_atomic_t watch_stop = 0;
+void stop_watch(int sig) {
+    watch_stop = 1;
+}
+
+// Watch mode, keeps the snapshot refreshed every interval_ms (0 = never) and answers query lines from stdin until EOF
+// With use_events the tree is kept current from kernel process events between refreshes
+int run_watch(ProcList *proclist, int interval_ms, int use_events) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_watch;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    // subscribing before the seed scan so nothing falls between the two
+    int events_fd = -1;
+    if (use_events) {
+        events_fd = open_proc_events();
+        if (events_fd == -1) {
+            fprintf(stderr, "Process events unavailable, falling back to periodic rescans\n");
+            if (interval_ms == 0) interval_ms = 1000;
+        }
+    }
+
+    // first snapshot is a full scan, later ones are incremental
+    scanprocfs(proclist, FIELD_VMRSS);
+    long long next_refresh = now_ms() + interval_ms;
+
+    char line[QUERY_LINE_MAX];
+    size_t len = 0;
+    while (!watch_stop) {
+        long long now = now_ms();
+        if (interval_ms && now >= next_refresh) {
+            refresh_procfs(proclist);
+            next_refresh = now + interval_ms;
+            continue;
+        }
+
+        struct pollfd pfds[2] = { { STDIN_FILENO, POLLIN, 0 }, { events_fd, POLLIN, 0 } };
+        int ready = poll(pfds, events_fd == -1 ? 1 : 2, interval_ms ? (int)(next_refresh - now) : -1);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+
+        // lost events leave the tree unknown, a full rescan resynchronises it
+        if (events_fd != -1 && (pfds[1].revents & POLLIN) && !read_proc_events(proclist, events_fd)) {
+            scanprocfs(proclist, FIELD_VMRSS);
+        }
+        if (!(pfds[0].revents & (POLLIN | POLLHUP))) continue;
+
+        ssize_t n = read(STDIN_FILENO, line + len, sizeof(line) - 1 - len);
+        if (n <= 0) break;
+        len += n;
+
+        // running every complete line, keeping a partial one for the next read
+        char *start = line;
+        char *newline;
+        while ((newline = memchr(start, '\n', line + len - start))) {
+            *newline = '\0';
+            run_query_line(proclist, start);
+            fflush(stdout);
+            start = newline + 1;
+        }
+        len = line + len - start;
+        memmove(line, start, len);
+        if (len == sizeof(line) - 1) len = 0;
+    }
+    if (events_fd != -1) close(events_fd);
+    return 0;
+}
+
+// Main Function
+int main(int num_args, char *arguments[]) {
+
+    // leading global options are consumed before the command
+    int watch_interval = 0;
+    int use_events = 0;
+    int batch = 0;
+    int allow_kill = 0;
+    const char *batch_file = NULL;
+    while (num_args > 1) {
+        if (strcmp(arguments[1], "-j") == 0) {
+            if (num_args < 3 || atoi(arguments[2]) < 1 || atoi(arguments[2]) > MAX_SCAN_THREADS) {
+                printf("Invalid thread count, -j expects 1 to %d\n", MAX_SCAN_THREADS);
+                return 1;
+            }
+            scan_threads = atoi(arguments[2]);
+            arguments = arguments + 2;
+            num_args = num_args - 2;
+        } else if (strcmp(arguments[1], "--events") == 0) {
+            use_events = 1;
+            arguments = arguments + 1;
+            num_args = num_args - 1;
+        } else if (strcmp(arguments[1], "--batch") == 0) {
+            // optional file operand, stdin when absent or "-"
+            batch = 1;
+            arguments = arguments + 1;
+            num_args = num_args - 1;
+            if (num_args > 1 && arguments[1][0] != '-') {
+                batch_file = arguments[1];
+                arguments = arguments + 1;
+                num_args = num_args - 1;
+            } else if (num_args > 1 && strcmp(arguments[1], "-") == 0) {
+                arguments = arguments + 1;
+                num_args = num_args - 1;
+            }
+        } else if (strcmp(arguments[1], "--allow-kill") == 0) {
+            allow_kill = 1;
+            arguments = arguments + 1;
+            num_args = num_args - 1;
+        } else if (strcmp(arguments[1], "--cgroup") == 0) {
+            use_cgroup = 1;
+            arguments = arguments + 1;
+            num_args = num_args - 1;
+        } else if (strcmp(arguments[1], "--uring") == 0) {
+            use_uring = 1;
+            arguments = arguments + 1;
+            num_args = num_args - 1;
+        } else if (strcmp(arguments[1], "--watch") == 0) {
+            if (num_args < 3 || atoi(arguments[2]) < 1) {
+                printf("Invalid interval, --watch expects milliseconds\n");
+                return 1;
+            }
+            watch_interval = atoi(arguments[2]);
+            arguments = arguments + 2;
+            num_args = num_args - 2;
+        } else {
+            break;
+        }
+    }
+
+    int query_mode = batch || watch_interval || use_events;
+    if (!query_mode && num_args != 2 && num_args != 3 && num_args != 4) {
+        printf("Invalid number of arguments\n");
+        return 1;
+    }
+
+    // Creating proc list
+    ProcList *proclist = create_proclist();
+    if (!proclist) {
+        printf("Memory allocation failed for proc list\n");
+        return 1;
+    }
+
+    // queries read from stdin or a file only signal when explicitly allowed
+    int status;
+    if (batch) {
+        FILE *in = batch_file ? fopen(batch_file, "r") : stdin;
+        if (!in) {
+            printf("Cannot open batch file %s\n", batch_file);
+            free_proclist(proclist);
+            return 1;
+        }
+        allow_signals = allow_kill;
+        status = run_batch(proclist, in);
+        if (batch_file) fclose(in);
+    } else if (watch_interval || use_events) {
+        allow_signals = allow_kill;
+        status = run_watch(proclist, watch_interval, use_events);
+    } else {
+        status = execute_command(proclist, num_args, arguments, 1);
+    }
+    free_proclist(proclist);
+    free(descendants);
+    free(level_hist);
+    return status;
+}